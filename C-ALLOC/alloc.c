@@ -6,94 +6,122 @@ _Atomic bool allocator_initialized = false;
 static pthread_once_t heap_init_once = PTHREAD_ONCE_INIT;
 
 static const size_t size_classes[MAX_SIZE_CLASSES] = {
-    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
-    1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576, 32768, 49152
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256,
+    320, 384, 448, 512, 640, 768, 896, 1024, 1536, 2048, 3072, 4096,
+    6144, 8192, 12288, 16384, 24576, 32768, 49152, 65536
 };
 
-static heap global_mem = {0};
+// Per-class block and slab geometry, computed once in init()
+static size_t class_block_size[MAX_SIZE_CLASSES];
+static size_t class_slab_size[MAX_SIZE_CLASSES];
+static int class_blocks_per_slab[MAX_SIZE_CLASSES];
+static uint8_t small_class_lookup[SMALL_LOOKUP_MAX / ALIGNMENT + 1];
+
+static heap arenas[NUM_ARENAS];
+static _Atomic unsigned next_arena = 0;
 
 __thread tcache_t tcache = {0};
 __thread bool tcache_initialized = false;
+__thread heap *thread_arena = NULL;
+__thread tcache_ctl *tctl = NULL;
+
+// Registry of live heaps and thread caches walked by the maintenance thread
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    heap *heaps;
+    tcache_ctl *threads;
+    pthread_key_t thread_key;
+    bool key_created;
+    _Atomic bool running;
+    pthread_t worker;
+    unsigned interval_ms;
+    bool print_stats;
+    pthread_mutex_t stats_lock;
+    allocator_stats published;
+} maint = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .stats_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
 
+// Metadata slabs are chained on demand; each starts with this link
+typedef struct meta_slab {
+    struct meta_slab *next;
+    size_t size;
+} meta_slab;
 
+// Free metadata blocks sit on exact-size lists, so allocation and free
+// never walk blocks that are in use. Sizes above the binned range share
+// the last list, which only ever holds a few distinct struct sizes.
 static struct {
+    meta_slab *slabs;
     void *slab;
     size_t slab_size;
     size_t offset;
-    meta_block *free_list;
+    meta_block *bins[META_BINS + 1];
     pthread_mutex_t lock;
-} meta_allocator = {0};
+} meta_allocator = { .lock = PTHREAD_MUTEX_INITIALIZER };
 
 #define HANDLE_ERROR(msg) \
     do { perror(msg); exit(EXIT_FAILURE); } while (0)
 
-static void init_meta_allocator(void) {
-    if (meta_allocator.slab) return;
-    meta_allocator.slab = mmap(NULL, META_SLAB_SIZE, PROT_READ | PROT_WRITE,
-                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (meta_allocator.slab == MAP_FAILED) {
-        fprintf(stderr, "Error: mmap failed in init_meta_allocator: %s\n", strerror(errno));
-        meta_allocator.slab = NULL;
-        return;
-    }
-    meta_allocator.slab_size = META_SLAB_SIZE;
-    meta_allocator.offset = 0;
-    meta_allocator.free_list = NULL;
-    if (pthread_mutex_init(&meta_allocator.lock, NULL) != 0) {
-        HANDLE_ERROR("pthread_mutex_init failed in init_meta_allocator");
+// Caller holds meta_allocator.lock. Maps a new slab large enough for
+// min_size bytes and makes it the one bump allocation carves from.
+static int meta_add_slab(const size_t min_size) {
+    size_t slab_size = min_size + sizeof(meta_slab) > META_SLAB_SIZE ?
+                       min_size + sizeof(meta_slab) : META_SLAB_SIZE;
+    meta_slab *slab = mmap(NULL, slab_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap failed in meta_add_slab: %s\n", strerror(errno));
+        return 0;
     }
+    slab->size = slab_size;
+    slab->next = meta_allocator.slabs;
+    meta_allocator.slabs = slab;
+    meta_allocator.slab = slab;
+    meta_allocator.slab_size = slab_size;
+    meta_allocator.offset = sizeof(meta_slab);
+    return 1;
+}
+
+static inline int meta_bin_index(const size_t aligned_size) {
+    size_t bin = aligned_size / 8 - 1;
+    return bin < META_BINS ? (int)bin : META_BINS;
 }
 
 static void *meta_alloc(const size_t size) {
-    if (!meta_allocator.slab) {
-        init_meta_allocator();
-        if (!meta_allocator.slab) return NULL;
-    }
-    size_t aligned_size = (size + 7U) & ~7U;
+    size_t aligned_size = size ? (size + 7U) & ~7U : 8U;
     if (pthread_mutex_lock(&meta_allocator.lock) != 0) {
         HANDLE_ERROR("pthread_mutex_lock failed in meta_alloc");
     }
-    meta_block *current = meta_allocator.free_list;
-    meta_block *prev = NULL;
-    while (current) {
-        if (current->free && current->size >= aligned_size) {
-            current->free = 0;
-            if (current->size > aligned_size + sizeof(meta_block) + 32) {
-                meta_block *new_block = (meta_block *)((char *)(current + 1) + aligned_size);
-                new_block->size = current->size - aligned_size - sizeof(meta_block);
-                new_block->free = 1;
-                new_block->next = current->next;
-                current->next = new_block;
-                current->size = aligned_size;
-            }
-            if (pthread_mutex_unlock(&meta_allocator.lock) != 0) {
-                HANDLE_ERROR("pthread_mutex_unlock failed in meta_alloc");
-            }
-            return (void *)(current + 1);
-        }
-        prev = current;
-        current = current->next;
+    meta_block **link = &meta_allocator.bins[meta_bin_index(aligned_size)];
+    while (*link && (*link)->size != aligned_size) {
+        link = &(*link)->next;
     }
-    size_t total_size = sizeof(meta_block) + aligned_size;
-    if (meta_allocator.offset + total_size > meta_allocator.slab_size) {
-        fprintf(stderr, "Error: meta_alloc out of memory\n");
-        pthread_mutex_unlock(&meta_allocator.lock);
-        return NULL;
-    }
-    meta_block *new_block = (meta_block *)((char *)meta_allocator.slab + meta_allocator.offset);
-    meta_allocator.offset += total_size;
-    new_block->size = aligned_size;
-    new_block->free = 0;
-    new_block->next = NULL;
-    if (prev) {
-        prev->next = new_block;
+    meta_block *block = *link;
+    if (block) {
+        *link = block->next;
     } else {
-        meta_allocator.free_list = new_block;
+        size_t total_size = sizeof(meta_block) + aligned_size;
+        if ((!meta_allocator.slab || meta_allocator.offset + total_size > meta_allocator.slab_size) &&
+            !meta_add_slab(total_size)) {
+            fprintf(stderr, "Error: meta_alloc out of memory\n");
+            pthread_mutex_unlock(&meta_allocator.lock);
+            return NULL;
+        }
+        block = (meta_block *)((char *)meta_allocator.slab + meta_allocator.offset);
+        meta_allocator.offset += total_size;
+        block->size = aligned_size;
     }
+    block->free = 0;
+    block->next = NULL;
     if (pthread_mutex_unlock(&meta_allocator.lock) != 0) {
-        HANDLE_ERROR("pthread_mutex_unlock failed in meta_alloc (end)");
+        HANDLE_ERROR("pthread_mutex_unlock failed in meta_alloc");
     }
-    return (void *)(new_block + 1);
+    return (void *)(block + 1);
 }
 
 static void *meta_calloc(const size_t num, const size_t size) {
@@ -111,10 +139,11 @@ static void meta_free(void *ptr) {
     if (pthread_mutex_lock(&meta_allocator.lock) != 0) {
         HANDLE_ERROR("pthread_mutex_lock failed in meta_free");
     }
-    block->free = 1;
-    if (block->next && block->next->free) {
-        block->size += sizeof(meta_block) + block->next->size;
-        block->next = block->next->next;
+    if (!block->free) {
+        block->free = 1;
+        meta_block **bin = &meta_allocator.bins[meta_bin_index(block->size)];
+        block->next = *bin;
+        *bin = block;
     }
     if (pthread_mutex_unlock(&meta_allocator.lock) != 0) {
         HANDLE_ERROR("pthread_mutex_unlock failed in meta_free");
@@ -126,43 +155,496 @@ static inline size_t align_size(const size_t size) {
 }
 
 static inline int get_size_class(const size_t size) {
+    if (size <= SMALL_LOOKUP_MAX) {
+        return small_class_lookup[(size + ALIGNMENT - 1) / ALIGNMENT];
+    }
     for (int i = 0; i < MAX_SIZE_CLASSES; ++i) {
         if (size <= size_classes[i]) return i;
     }
     return -1;
 }
 
+#if ALLOC_TRACE
+static _Atomic bool trace_enabled = false;
+static __thread trace_ring *trace_buf = NULL;
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    trace_ring *rings;
+    _Atomic uint16_t next_thread_id;
+    _Atomic bool running;
+    pthread_t flusher;
+    int fd;
+    char *map;
+    size_t map_size;
+    size_t offset;
+    uint64_t record_count;
+    uint64_t dropped;
+} tracer = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .fd = -1 };
+
+static inline uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void trace_ring_retire(void *arg) {
+    trace_ring *ring = arg;
+    if (ring) {
+        atomic_store(&ring->retired, true);
+    }
+    trace_buf = NULL;
+}
+
+static void trace_key_create(void) {
+    if (pthread_key_create(&trace_key, trace_ring_retire) != 0) {
+        HANDLE_ERROR("pthread_key_create failed in trace_key_create");
+    }
+}
+
+static trace_ring *trace_ring_create(void) {
+    pthread_once(&trace_key_once, trace_key_create);
+    trace_ring *ring = mmap(NULL, sizeof(trace_ring), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap failed in trace_ring_create: %s\n", strerror(errno));
+        return NULL;
+    }
+    ring->thread_id = atomic_fetch_add(&tracer.next_thread_id, 1);
+    pthread_mutex_lock(&tracer.lock);
+    ring->next = tracer.rings;
+    tracer.rings = ring;
+    pthread_mutex_unlock(&tracer.lock);
+    pthread_setspecific(trace_key, ring);
+    trace_buf = ring;
+    return ring;
+}
+
+// Caller holds tracer.lock
+static int trace_file_reserve(const size_t bytes) {
+    if (tracer.offset + bytes <= tracer.map_size) return 1;
+    size_t new_size = tracer.map_size;
+    while (tracer.offset + bytes > new_size) {
+        new_size += TRACE_FILE_CHUNK;
+    }
+    if (tracer.map) {
+        munmap(tracer.map, tracer.map_size);
+        tracer.map = NULL;
+    }
+    if (ftruncate(tracer.fd, (off_t)new_size) != 0) {
+        fprintf(stderr, "Error: ftruncate failed in trace_file_reserve: %s\n", strerror(errno));
+        return 0;
+    }
+    void *map = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, tracer.fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap failed in trace_file_reserve: %s\n", strerror(errno));
+        return 0;
+    }
+    tracer.map = map;
+    tracer.map_size = new_size;
+    return 1;
+}
+
+// Caller holds tracer.lock
+static void trace_drain_ring(trace_ring *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t pending = head - tail;
+    if (pending > 0 && tracer.map && trace_file_reserve(pending * sizeof(trace_record))) {
+        for (size_t i = 0; i < pending; i++) {
+            memcpy(tracer.map + tracer.offset,
+                   &ring->records[(tail + i) & (TRACE_RING_RECORDS - 1)],
+                   sizeof(trace_record));
+            tracer.offset += sizeof(trace_record);
+        }
+        tracer.record_count += pending;
+        atomic_store_explicit(&ring->tail, head, memory_order_release);
+    }
+    tracer.dropped += atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+}
+
+// Caller holds tracer.lock
+static void trace_drain(void) {
+    trace_ring **link = &tracer.rings;
+    while (*link) {
+        trace_ring *ring = *link;
+        bool retired = atomic_load(&ring->retired);
+        trace_drain_ring(ring);
+        if (retired && atomic_load(&ring->tail) == atomic_load(&ring->head)) {
+            *link = ring->next;
+            munmap(ring, sizeof(trace_ring));
+            continue;
+        }
+        link = &ring->next;
+    }
+    if (tracer.map) {
+        trace_file_header *hdr = (trace_file_header *)tracer.map;
+        hdr->record_count = tracer.record_count;
+        hdr->dropped = tracer.dropped;
+    }
+}
+
+// Hot path: one clock read and a store into the caller's own ring.
+// Crossing half capacity wakes the flusher early; if the ring still fills
+// (e.g. the flusher has no CPU to run on), the producer drains its own ring
+// into the file. Records are only dropped when the file cannot be written.
+static void trace_event(const uint8_t op, const size_t size, const void *ptr) {
+    trace_ring *ring = trace_buf;
+    if (!ring && !(ring = trace_ring_create())) return;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= TRACE_RING_RECORDS) {
+        pthread_mutex_lock(&tracer.lock);
+        trace_drain_ring(ring);
+        pthread_mutex_unlock(&tracer.lock);
+        tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - tail >= TRACE_RING_RECORDS) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        }
+    } else if (head - tail == TRACE_RING_RECORDS / 2) {
+        pthread_cond_signal(&tracer.wake);
+    }
+    trace_record *rec = &ring->records[head & (TRACE_RING_RECORDS - 1)];
+    rec->timestamp_ns = trace_now_ns();
+    rec->ptr_id = (uint64_t)(uintptr_t)ptr;
+    rec->size = size > UINT32_MAX ? UINT32_MAX : (uint32_t)size;
+    rec->thread_id = ring->thread_id;
+    rec->op = op;
+    rec->reserved = 0;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static void *trace_flusher(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&tracer.lock);
+    while (atomic_load(&tracer.running)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (TRACE_FLUSH_INTERVAL_MS % 1000) * 1000000L;
+        deadline.tv_sec += TRACE_FLUSH_INTERVAL_MS / 1000 + deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&tracer.wake, &tracer.lock, &deadline);
+        trace_drain();
+    }
+    pthread_mutex_unlock(&tracer.lock);
+    return NULL;
+}
+
+int allocator_trace_start(const char *path) {
+    if (!path) return -1;
+    pthread_mutex_lock(&tracer.lock);
+    if (atomic_load(&tracer.running)) {
+        pthread_mutex_unlock(&tracer.lock);
+        return -1;
+    }
+    tracer.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (tracer.fd < 0) {
+        fprintf(stderr, "Error: open failed in allocator_trace_start: %s\n", strerror(errno));
+        pthread_mutex_unlock(&tracer.lock);
+        return -1;
+    }
+    tracer.map = NULL;
+    tracer.map_size = 0;
+    tracer.offset = 0;
+    tracer.record_count = 0;
+    tracer.dropped = 0;
+    if (!trace_file_reserve(sizeof(trace_file_header))) {
+        close(tracer.fd);
+        tracer.fd = -1;
+        pthread_mutex_unlock(&tracer.lock);
+        return -1;
+    }
+    trace_file_header *hdr = (trace_file_header *)tracer.map;
+    hdr->magic = TRACE_MAGIC;
+    hdr->record_size = sizeof(trace_record);
+    hdr->record_count = 0;
+    hdr->dropped = 0;
+    tracer.offset = sizeof(trace_file_header);
+    // Discard anything left in the rings from an earlier session
+    for (trace_ring *ring = tracer.rings; ring; ring = ring->next) {
+        atomic_store(&ring->tail, atomic_load(&ring->head));
+        atomic_store(&ring->dropped, 0);
+    }
+    atomic_store(&tracer.running, true);
+    if (pthread_create(&tracer.flusher, NULL, trace_flusher, NULL) != 0) {
+        fprintf(stderr, "Error: pthread_create failed in allocator_trace_start\n");
+        atomic_store(&tracer.running, false);
+        munmap(tracer.map, tracer.map_size);
+        tracer.map = NULL;
+        close(tracer.fd);
+        tracer.fd = -1;
+        pthread_mutex_unlock(&tracer.lock);
+        return -1;
+    }
+    atomic_store(&trace_enabled, true);
+    pthread_mutex_unlock(&tracer.lock);
+    return 0;
+}
+
+void allocator_trace_stop(void) {
+    pthread_mutex_lock(&tracer.lock);
+    if (!atomic_load(&tracer.running)) {
+        pthread_mutex_unlock(&tracer.lock);
+        return;
+    }
+    atomic_store(&trace_enabled, false);
+    atomic_store(&tracer.running, false);
+    pthread_cond_signal(&tracer.wake);
+    pthread_mutex_unlock(&tracer.lock);
+    pthread_join(tracer.flusher, NULL);
+    pthread_mutex_lock(&tracer.lock);
+    trace_drain();
+    if (tracer.map) {
+        munmap(tracer.map, tracer.map_size);
+        tracer.map = NULL;
+    }
+    if (ftruncate(tracer.fd, (off_t)tracer.offset) != 0) {
+        fprintf(stderr, "Error: ftruncate failed in allocator_trace_stop: %s\n", strerror(errno));
+    }
+    close(tracer.fd);
+    tracer.fd = -1;
+    pthread_mutex_unlock(&tracer.lock);
+}
+#else
+int allocator_trace_start(const char *path) {
+    (void)path;
+    return -1;
+}
+
+void allocator_trace_stop(void) {}
+#endif
+
+static double slab_waste_ratio(const int sc_index) {
+    size_t used = class_block_size[sc_index] * (size_t)class_blocks_per_slab[sc_index];
+    return (double)(class_slab_size[sc_index] - used) / (double)class_slab_size[sc_index];
+}
+
+// Chooses the smallest page-multiple slab per class whose tail waste stays
+// under SLAB_WASTE_TARGET, falling back to the least wasteful size.
+static void init_size_class_layout(void) {
+    const size_t page = (size_t)getpagesize();
+    for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
+        size_t block_size = align_size(sizeof(block_header) + size_classes[i]);
+        size_t best_size = 0;
+        double best_waste = 1.0;
+        for (size_t slab_size = SLAB_SIZE; slab_size <= MAX_SLAB_SIZE; slab_size += page) {
+            size_t blocks = slab_size / block_size;
+            if (blocks == 0) continue;
+            double waste = (double)(slab_size - blocks * block_size) / (double)slab_size;
+            if (waste < best_waste) {
+                best_waste = waste;
+                best_size = slab_size;
+            }
+            if (waste <= SLAB_WASTE_TARGET) break;
+        }
+        class_block_size[i] = block_size;
+        class_slab_size[i] = best_size;
+        class_blocks_per_slab[i] = (int)(best_size / block_size);
+    }
+    for (size_t i = 0, sc = 0; i <= SMALL_LOOKUP_MAX / ALIGNMENT; i++) {
+        while (size_classes[sc] < i * ALIGNMENT) sc++;
+        small_class_lookup[i] = (uint8_t)sc;
+    }
+}
+
+static void heap_register(heap *h) {
+    pthread_mutex_lock(&maint.lock);
+    h->next = maint.heaps;
+    maint.heaps = h;
+    pthread_mutex_unlock(&maint.lock);
+}
+
+static void heap_unregister(heap *h) {
+    pthread_mutex_lock(&maint.lock);
+    for (heap **link = &maint.heaps; *link; link = &(*link)->next) {
+        if (*link == h) {
+            *link = h->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&maint.lock);
+}
+
+static void tcache_thread_exit(void *arg) {
+    tcache_ctl *ctl = arg;
+    if (!atomic_load(&allocator_initialized)) return;
+    thread_cache_cleanup();
+    atomic_store(&ctl->retired, true);
+    tctl = NULL;
+}
+
+static void tcache_register(void) {
+    if (tctl) return;
+    tcache_ctl *ctl = meta_calloc(1, sizeof(tcache_ctl));
+    if (!ctl) return;
+    pthread_mutex_lock(&maint.lock);
+    ctl->next = maint.threads;
+    maint.threads = ctl;
+    pthread_mutex_unlock(&maint.lock);
+    if (maint.key_created) {
+        pthread_setspecific(maint.thread_key, ctl);
+    }
+    tctl = ctl;
+}
+
+// Threads are spread round-robin over the arenas to shard Globally::lock
 static void init_tcache(void) {
     if (!tcache_initialized && atomic_load(&allocator_initialized)) {
         memset(&tcache, 0, sizeof(tcache));
+        thread_arena = &arenas[atomic_fetch_add(&next_arena, 1) % NUM_ARENAS];
+        tcache_register();
         tcache_initialized = true;
     }
 }
 
+// Free blocks are kept per slab so the maintenance pass can spot empty
+// slabs from their counts alone. Callers hold global_list->lock.
+static inline void partial_unlink(Globally *global_list, slab_node *slab) {
+    if (slab->partial_prev) {
+        slab->partial_prev->partial_next = slab->partial_next;
+    } else {
+        global_list->partial = slab->partial_next;
+    }
+    if (slab->partial_next) {
+        slab->partial_next->partial_prev = slab->partial_prev;
+    }
+}
+
+static inline void class_push(Globally *global_list, block_header *block) {
+    slab_node *slab = block->slab;
+    block->next = slab->free_list;
+    slab->free_list = block;
+    if (slab->free_count++ == 0) {
+        slab->partial_prev = NULL;
+        slab->partial_next = global_list->partial;
+        if (global_list->partial) global_list->partial->partial_prev = slab;
+        global_list->partial = slab;
+    }
+}
+
+static inline block_header *class_pop(Globally *global_list) {
+    slab_node *slab = global_list->partial;
+    if (!slab) return NULL;
+    block_header *block = slab->free_list;
+    slab->free_list = block->next;
+    if (--slab->free_count == 0) {
+        partial_unlink(global_list, slab);
+    }
+    return block;
+}
+
+// Runs on the owning thread once the maintenance thread asks for a trim.
+// Blocks below each class's low-water mark went unused for a whole
+// interval, so they go back to the arena; the oldest entries leave first.
+static void tcache_gc(void) {
+    atomic_store_explicit(&tctl->trim_requested, false, memory_order_relaxed);
+    for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
+        cache_entry *entry = &tcache.cache[i];
+        int trim = entry->low_water < entry->cache_count ? entry->low_water : entry->cache_count;
+        Globally *global_list = &thread_arena->classes[i];
+        if (trim > 0 && pthread_mutex_lock(&global_list->lock) == 0) {
+            for (int j = 0; j < trim; j++) {
+                class_push(global_list, entry->cache_list[j]);
+            }
+            pthread_mutex_unlock(&global_list->lock);
+            entry->cache_count -= trim;
+            memmove(entry->cache_list, entry->cache_list + trim,
+                    (size_t)entry->cache_count * sizeof(block_header *));
+        }
+        entry->low_water = entry->cache_count;
+    }
+}
+
+static void heap_setup(heap *h) {
+    memset(h, 0, sizeof(*h));
+    if (pthread_mutex_init(&h->large_lock, NULL) != 0 ||
+        pthread_mutex_init(&h->medium.lock, NULL) != 0) {
+        HANDLE_ERROR("pthread_mutex_init failed in heap_setup");
+    }
+    for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
+        if (pthread_mutex_init(&h->classes[i].lock, NULL) != 0) {
+            HANDLE_ERROR("pthread_mutex_init failed in heap_setup");
+        }
+    }
+}
+
+// Drops every slab, span region and large mapping the heap owns in one pass
+static void heap_release(heap *h) {
+    for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
+        Globally *global_list = &h->classes[i];
+        slab_node *lists[2] = { global_list->slabs, global_list->purged };
+        for (int l = 0; l < 2; l++) {
+            slab_node *slab = lists[l];
+            while (slab) {
+                slab_node *next = slab->next;
+                if (slab->slab) {
+                    munmap(slab->slab, slab->size);
+                }
+                meta_free(slab);
+                slab = next;
+            }
+        }
+        global_list->slabs = NULL;
+        global_list->purged = NULL;
+        global_list->partial = NULL;
+        pthread_mutex_destroy(&global_list->lock);
+    }
+    slab_node *large_slab = h->large_slabs;
+    while (large_slab) {
+        slab_node *next = large_slab->next;
+        if (large_slab->slab) {
+            munmap(large_slab->slab, large_slab->size);
+        }
+        meta_free(large_slab);
+        large_slab = next;
+    }
+    h->large_slabs = NULL;
+    medium_region *region = h->medium.regions;
+    while (region) {
+        medium_region *next = region->next;
+        munmap(region, MEDIUM_REGION_SIZE);
+        region = next;
+    }
+    h->medium.regions = NULL;
+    pthread_mutex_destroy(&h->large_lock);
+    pthread_mutex_destroy(&h->medium.lock);
+}
+
 void init(void) {
     if (atomic_load(&allocator_initialized)) return;
     static volatile int init_lock = 0;
     while (__sync_lock_test_and_set(&init_lock, 1)) {}
     if (!atomic_load(&allocator_initialized)) {
-        memset(&global_mem, 0, sizeof(global_mem));
-        for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
-            global_mem.global_free_list[i] = meta_calloc(1, sizeof(Globally));
-            if (global_mem.global_free_list[i]) {
-                if (pthread_mutex_init(&global_mem.global_free_list[i]->lock, NULL) != 0) {
-                    HANDLE_ERROR("pthread_mutex_init failed in init");
-                }
-                global_mem.global_free_list[i]->slabs = NULL;
-                global_mem.global_free_list[i]->free_list = NULL;
-            } else {
-                fprintf(stderr, "Error: meta_calloc failed in init for size class %d\n", i);
+        init_size_class_layout();
+        for (int i = 0; i < NUM_ARENAS; i++) {
+            heap_setup(&arenas[i]);
+            arenas[i].is_arena = true;
+            heap_register(&arenas[i]);
+        }
+        if (!maint.key_created) {
+            if (pthread_key_create(&maint.thread_key, tcache_thread_exit) != 0) {
+                HANDLE_ERROR("pthread_key_create failed in init");
             }
+            maint.key_created = true;
         }
-        global_mem.large_free_list = NULL;
-        global_mem.large_slabs = NULL;
         atomic_thread_fence(memory_order_seq_cst);
         atomic_store(&allocator_initialized, true);
     }
     __sync_lock_release(&init_lock);
+    const char *interval = getenv(MAINT_INTERVAL_ENV);
+    if (interval && atoi(interval) > 0 && !atomic_load(&maint.running)) {
+        allocator_maintenance_start((unsigned)atoi(interval));
+    }
+#if ALLOC_TRACE
+    const char *trace_path = getenv(TRACE_ENV);
+    if (trace_path && *trace_path && !atomic_load(&tracer.running)) {
+        allocator_trace_start(trace_path);
+    }
+#endif
 }
 
 static void *allocate_slab(size_t size) {
@@ -178,108 +660,310 @@ static void *allocate_slab(size_t size) {
     return slab;
 }
 
-static int populate_memory(const int sc_index) {
+// Caller holds h->classes[sc_index].lock
+static int populate_memory(heap *h, const int sc_index) {
     if (sc_index < 0 || sc_index >= MAX_SIZE_CLASSES) {
         return 0;
     }
-    size_t block_size = align_size(sizeof(block_header) + size_classes[sc_index]);
-    void *slab = allocate_slab(SLAB_SIZE);
-    if (!slab) return 0;
-    int blocks_in_slab = (int)((SLAB_SIZE - sizeof(slab_node)) / block_size);
+    size_t block_size = class_block_size[sc_index];
+    size_t slab_size = class_slab_size[sc_index];
+    int blocks_in_slab = class_blocks_per_slab[sc_index];
     if (blocks_in_slab <= 0) {
-        munmap(slab, SLAB_SIZE);
         return 0;
     }
-    slab_node *node = meta_alloc(sizeof(slab_node));
-    if (!node) {
-        munmap(slab, SLAB_SIZE);
-        return 0;
+    Globally *global_list = &h->classes[sc_index];
+    slab_node *node = global_list->purged;
+    void *slab;
+    if (node) {
+        global_list->purged = node->next;
+        slab = node->slab;
+    } else {
+        slab = allocate_slab(slab_size);
+        if (!slab) return 0;
+        node = meta_alloc(sizeof(slab_node));
+        if (!node) {
+            munmap(slab, slab_size);
+            return 0;
+        }
+        node->slab = slab;
+        node->size = slab_size;
+        node->owner = h;
     }
-    node->slab = slab;
-    node->size = SLAB_SIZE;
-    node->next = global_mem.global_free_list[sc_index]->slabs;
-    global_mem.global_free_list[sc_index]->slabs = node;
-    block_header *new_free_list = (block_header *)slab;
+    node->decay = 0;
+    node->next = global_list->slabs;
+    global_list->slabs = node;
     for (int i = 0; i < blocks_in_slab; i++) {
         block_header *blk = (block_header *)((char *)slab + i * block_size);
         blk->size_class = sc_index;
         blk->freed = false;
         blk->magic = BLOCK_MAGIC;
+        blk->slab = node;
         blk->next = (i == blocks_in_slab - 1) ? NULL :
                     (block_header *)((char *)slab + (i + 1) * block_size);
     }
-    block_header *tail = new_free_list;
-    while (tail->next) tail = tail->next;
-    tail->next = global_mem.global_free_list[sc_index]->free_list;
-    global_mem.global_free_list[sc_index]->free_list = new_free_list;
+    node->free_list = (block_header *)slab;
+    node->free_count = blocks_in_slab;
+    node->partial_prev = NULL;
+    node->partial_next = global_list->partial;
+    if (global_list->partial) global_list->partial->partial_prev = node;
+    global_list->partial = node;
     return 1;
 }
 
-static void *large_alloc(const size_t size) {
+// Freed large mappings stay cached for reuse; a cached mapping is taken if
+// it fits without wasting more than half of it.
+static void *large_alloc(heap *h, const size_t size) {
     size_t total_size = align_size(size + sizeof(large_block));
+    if (pthread_mutex_lock(&h->large_lock) != 0) {
+        HANDLE_ERROR("pthread_mutex_lock failed in large_alloc");
+    }
+    slab_node *node = NULL;
+    for (slab_node *cached = h->large_slabs; cached; cached = cached->next) {
+        large_block *candidate = (large_block *)cached->slab;
+        if (candidate->free && candidate->freed && cached->size >= total_size &&
+            cached->size / 2 <= total_size && (!node || cached->size < node->size)) {
+            node = cached;
+        }
+    }
+    if (node) {
+        large_block *block = (large_block *)node->slab;
+        block->size = size;
+        block->free = 0;
+        block->freed = false;
+        node->decay = 0;
+        pthread_mutex_unlock(&h->large_lock);
+        return (void *)(block + 1);
+    }
+    pthread_mutex_unlock(&h->large_lock);
     void *slab = allocate_slab(total_size);
     if (!slab) return NULL;
-    slab_node *node = meta_alloc(sizeof(slab_node));
+    node = meta_alloc(sizeof(slab_node));
     if (!node) {
         munmap(slab, total_size);
         return NULL;
     }
     node->slab = slab;
     node->size = total_size;
-    node->next = global_mem.large_slabs;
-    global_mem.large_slabs = node;
+    node->owner = h;
+    node->free_count = 0;
+    node->decay = 0;
+    // The header is complete before the node is published to the purge pass
     large_block *block = (large_block *)slab;
     block->size = size;
+    block->owner = h;
     block->free = 0;
     block->freed = false;
+    block->next = NULL;
     block->magic = LARGE_MAGIC;
+    if (pthread_mutex_lock(&h->large_lock) != 0) {
+        HANDLE_ERROR("pthread_mutex_lock failed in large_alloc");
+    }
+    node->next = h->large_slabs;
+    h->large_slabs = node;
+    pthread_mutex_unlock(&h->large_lock);
+    return (void *)(block + 1);
+}
+
+static inline int medium_bin_index(const size_t pages) {
+    return pages <= MEDIUM_MAX_PAGES ? (int)pages - 1 : MEDIUM_BINS - 1;
+}
+
+static inline medium_region *medium_region_of(const void *ptr) {
+    return (medium_region *)((uintptr_t)ptr & ~((uintptr_t)MEDIUM_REGION_SIZE - 1));
+}
+
+static inline size_t medium_page_of(const medium_region *region, const void *ptr) {
+    return ((uintptr_t)ptr - (uintptr_t)region) / MEDIUM_PAGE_SIZE;
+}
+
+static inline medium_span *medium_span_at(medium_region *region, const size_t page) {
+    return (medium_span *)((char *)region + page * MEDIUM_PAGE_SIZE);
+}
+
+static inline void medium_set_span(medium_region *region, const size_t page,
+                                   const size_t pages, const bool free) {
+    uint32_t entry = (uint32_t)(pages << 1) | (free ? 1U : 0U);
+    region->page_map[page] = entry;
+    region->page_map[page + pages - 1] = entry;
+}
+
+// Caller holds medium->lock
+static void medium_bin_insert(medium_heap *medium, medium_region *region,
+                              const size_t page, const size_t pages) {
+    medium_span *span = medium_span_at(region, page);
+    int bin = medium_bin_index(pages);
+    medium_set_span(region, page, pages, true);
+    span->header.size = pages * MEDIUM_PAGE_SIZE;
+    span->header.free = 1;
+    span->header.freed = true;
+    span->header.magic = MEDIUM_MAGIC;
+    span->decay = 0;
+    span->prev = NULL;
+    span->next = medium->bins[bin];
+    if (span->next) span->next->prev = span;
+    medium->bins[bin] = span;
+    medium->bin_bitmap[bin / 64] |= 1ULL << (bin % 64);
+}
+
+// Caller holds medium->lock
+static void medium_bin_remove(medium_heap *medium, medium_span *span, const size_t pages) {
+    int bin = medium_bin_index(pages);
+    if (span->prev) {
+        span->prev->next = span->next;
+    } else {
+        medium->bins[bin] = span->next;
+    }
+    if (span->next) span->next->prev = span->prev;
+    if (!medium->bins[bin]) {
+        medium->bin_bitmap[bin / 64] &= ~(1ULL << (bin % 64));
+    }
+}
+
+// Caller holds medium->lock. Exact-size bins make the first non-empty bin at
+// or above the request the best fit; only the oversized bin needs a walk.
+static medium_span *medium_find_span(medium_heap *medium, const size_t pages) {
+    int bin = medium_bin_index(pages);
+    int word = bin / 64;
+    uint64_t bits = medium->bin_bitmap[word] & (~0ULL << (bin % 64));
+    while (!bits) {
+        if (++word >= (MEDIUM_BINS + 63) / 64) return NULL;
+        bits = medium->bin_bitmap[word];
+    }
+    bin = word * 64 + __builtin_ctzll(bits);
+    if (bin < MEDIUM_BINS - 1) return medium->bins[bin];
+    medium_span *best = NULL;
+    size_t best_pages = SIZE_MAX;
+    for (medium_span *span = medium->bins[bin]; span; span = span->next) {
+        medium_region *region = medium_region_of(span);
+        size_t span_pages = region->page_map[medium_page_of(region, span)] >> 1;
+        if (span_pages < best_pages) {
+            best = span;
+            best_pages = span_pages;
+        }
+    }
+    return best;
+}
+
+// Caller holds medium->lock. Regions are aligned to their size so a span
+// finds its region (and page map) by masking its address.
+static medium_region *medium_add_region(medium_heap *medium) {
+    size_t map_size = 2 * (size_t)MEDIUM_REGION_SIZE;
+    char *raw = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap failed in medium_add_region: %s\n", strerror(errno));
+        return NULL;
+    }
+    char *aligned = (char *)(((uintptr_t)raw + MEDIUM_REGION_SIZE - 1) &
+                             ~((uintptr_t)MEDIUM_REGION_SIZE - 1));
+    size_t head = (size_t)(aligned - raw);
+    size_t tail = map_size - head - MEDIUM_REGION_SIZE;
+    if (head) munmap(raw, head);
+    if (tail) munmap(aligned + MEDIUM_REGION_SIZE, tail);
+    medium_region *region = (medium_region *)aligned;
+    region->owner = medium;
+    region->next = medium->regions;
+    medium->regions = region;
+    medium_bin_insert(medium, region, MEDIUM_HEADER_PAGES,
+                      MEDIUM_REGION_PAGES - MEDIUM_HEADER_PAGES);
+    // Fresh pages were never touched, so there is nothing to purge yet
+    medium_span_at(region, MEDIUM_HEADER_PAGES)->decay = 2;
+    return region;
+}
+
+static void *medium_alloc(medium_heap *medium, const size_t size) {
+    size_t pages = (size + sizeof(large_block) + MEDIUM_PAGE_SIZE - 1) / MEDIUM_PAGE_SIZE;
+    if (pthread_mutex_lock(&medium->lock) != 0) {
+        HANDLE_ERROR("pthread_mutex_lock failed in medium_alloc");
+    }
+    medium_span *span = medium_find_span(medium, pages);
+    if (!span && medium_add_region(medium)) {
+        span = medium_find_span(medium, pages);
+    }
+    if (!span) {
+        pthread_mutex_unlock(&medium->lock);
+        return NULL;
+    }
+    medium_region *region = medium_region_of(span);
+    size_t page = medium_page_of(region, span);
+    size_t span_pages = region->page_map[page] >> 1;
+    int decay = span->decay;
+    medium_bin_remove(medium, span, span_pages);
+    if (span_pages > pages) {
+        medium_bin_insert(medium, region, page + pages, span_pages - pages);
+        // A purged remainder stays purged; only its header page is touched
+        if (decay >= 2) medium_span_at(region, page + pages)->decay = 2;
+    }
+    medium_set_span(region, page, pages, false);
+    pthread_mutex_unlock(&medium->lock);
+    large_block *block = &span->header;
+    block->size = size;
+    block->free = 0;
+    block->freed = false;
+    block->magic = MEDIUM_MAGIC;
     block->next = NULL;
     return (void *)(block + 1);
 }
 
-void *my_alloc(const size_t size) {
-    if (size == 0) return NULL;
-    if (!atomic_load(&allocator_initialized)) {
-        init();
-        if (!atomic_load(&allocator_initialized)) return NULL;
+static void medium_free(medium_heap *medium, large_block *block) {
+    medium_region *region = medium_region_of(block);
+    size_t page = medium_page_of(region, block);
+    if (pthread_mutex_lock(&medium->lock) != 0) {
+        HANDLE_ERROR("pthread_mutex_lock failed in medium_free");
     }
-    if (!tcache_initialized) {
-        init_tcache();
+    uint32_t entry = region->page_map[page];
+    if (block->freed || page < MEDIUM_HEADER_PAGES || entry == 0 || (entry & 1U)) {
+        pthread_mutex_unlock(&medium->lock);
+        return;
     }
+    size_t pages = entry >> 1;
+    block->freed = true;
+    block->free = 1;
+    if (page + pages < MEDIUM_REGION_PAGES && (region->page_map[page + pages] & 1U)) {
+        size_t right = region->page_map[page + pages] >> 1;
+        medium_bin_remove(medium, medium_span_at(region, page + pages), right);
+        pages += right;
+    }
+    if (page > MEDIUM_HEADER_PAGES && (region->page_map[page - 1] & 1U)) {
+        size_t left = region->page_map[page - 1] >> 1;
+        page -= left;
+        pages += left;
+        medium_bin_remove(medium, medium_span_at(region, page), left);
+    }
+    medium_bin_insert(medium, region, page, pages);
+    pthread_mutex_unlock(&medium->lock);
+}
+
+static void *heap_alloc_internal(heap *h, const size_t size, const bool use_tcache) {
     if (size >= LARGE_BLOCK_THRESHOLD) {
-        return large_alloc(size);
+        if (size <= MEDIUM_MAX_SIZE) {
+            return medium_alloc(&h->medium, size);
+        }
+        return large_alloc(h, size);
     }
     int sc_index = get_size_class(size);
     if (sc_index == -1) return NULL;
-    if (tcache.cache[sc_index].cache_count > 0) {
+    if (use_tcache && tcache.cache[sc_index].cache_count > 0) {
         block_header *block = tcache.cache[sc_index].cache_list[--tcache.cache[sc_index].cache_count];
+        if (tcache.cache[sc_index].cache_count < tcache.cache[sc_index].low_water) {
+            tcache.cache[sc_index].low_water = tcache.cache[sc_index].cache_count;
+        }
         if (block && block->magic == BLOCK_MAGIC) {
             block->freed = false;
             return (void *)(block + 1);
         }
     }
     block_header *block = NULL;
-    Globally *global_list = global_mem.global_free_list[sc_index];
-    if (global_list && pthread_mutex_trylock(&global_list->lock) == 0) {
-        block_header *free_list = global_list->free_list;
-        if (free_list) {
-            block = free_list;
-            global_list->free_list = block->next;
-        }
+    Globally *global_list = &h->classes[sc_index];
+    if (pthread_mutex_trylock(&global_list->lock) == 0) {
+        block = class_pop(global_list);
         pthread_mutex_unlock(&global_list->lock);
     }
-    if (!block && global_list) {
+    if (!block) {
         if (pthread_mutex_lock(&global_list->lock) == 0) {
-            block_header *free_list = global_list->free_list;
-            if (free_list) {
-                block = free_list;
-                global_list->free_list = block->next;
-            } else if (populate_memory(sc_index)) {
-                free_list = global_list->free_list;
-                if (free_list) {
-                    block = free_list;
-                    global_list->free_list = block->next;
-                }
+            block = class_pop(global_list);
+            if (!block && populate_memory(h, sc_index)) {
+                block = class_pop(global_list);
             }
             pthread_mutex_unlock(&global_list->lock);
         }
@@ -290,15 +974,33 @@ void *my_alloc(const size_t size) {
     return (void *)(block + 1);
 }
 
-void my_free(void *ptr) {
-    if (!ptr || !atomic_load(&allocator_initialized)) return;
-    if (!tcache_initialized) {
-        init_tcache();
-    }
+// Releases ptr back to the heap that owns it. With h set, blocks owned by
+// any other heap are ignored. Only the calling thread's arena uses the
+// tcache, so blocks of explicit heaps never outlive heap_destroy() in a cache.
+static void heap_free_internal(heap *h, void *ptr, const bool use_tcache) {
     large_block *large = (large_block *)((char *)ptr - sizeof(large_block));
-    if (large->magic == LARGE_MAGIC && !large->freed) {
-        large->freed = true;
-        large->free = 1;
+    if (large->magic == LARGE_MAGIC) {
+        // owner and magic never change after the mapping is published;
+        // free/freed are only touched under the owner's large_lock.
+        heap *owner = large->owner;
+        if (h && owner != h) {
+            return;
+        }
+        if (pthread_mutex_lock(&owner->large_lock) != 0) {
+            HANDLE_ERROR("pthread_mutex_lock failed in heap_free_internal");
+        }
+        if (!large->freed) {
+            large->freed = true;
+            large->free = 1;
+        }
+        pthread_mutex_unlock(&owner->large_lock);
+        return;
+    }
+    if (large->magic == MEDIUM_MAGIC && !large->freed) {
+        medium_heap *medium = medium_region_of(large)->owner;
+        if (!h || medium == &h->medium) {
+            medium_free(medium, large);
+        }
         return;
     }
     block_header *block = (block_header *)((char *)ptr - sizeof(block_header));
@@ -309,25 +1011,120 @@ void my_free(void *ptr) {
     if (sc_index < 0 || sc_index >= MAX_SIZE_CLASSES) {
         return;
     }
+    heap *owner = block->slab->owner;
+    if (h && owner != h) {
+        return;
+    }
     block->freed = true;
     block->next = NULL;
-    if (tcache.cache[sc_index].cache_count < CACHE_SIZE) {
-        tcache.cache[sc_index].cache_list[tcache.cache[sc_index].cache_count++] = block;
+    if (use_tcache && owner == thread_arena) {
+        if (tcache.cache[sc_index].cache_count < CACHE_SIZE) {
+            tcache.cache[sc_index].cache_list[tcache.cache[sc_index].cache_count++] = block;
+            return;
+        }
+        Globally *global_list = &owner->classes[sc_index];
+        if (pthread_mutex_lock(&global_list->lock) == 0) {
+            int flush_count = CACHE_SIZE / 2;
+            for (int i = 0; i < flush_count; i++) {
+                class_push(global_list, tcache.cache[sc_index].cache_list[--tcache.cache[sc_index].cache_count]);
+            }
+            pthread_mutex_unlock(&global_list->lock);
+            if (tcache.cache[sc_index].cache_count < tcache.cache[sc_index].low_water) {
+                tcache.cache[sc_index].low_water = tcache.cache[sc_index].cache_count;
+            }
+            tcache.cache[sc_index].cache_list[tcache.cache[sc_index].cache_count++] = block;
+        }
         return;
     }
-    Globally *global_list = global_mem.global_free_list[sc_index];
-    if (global_list && pthread_mutex_trylock(&global_list->lock) == 0) {
-        int flush_count = CACHE_SIZE / 2;
-        for (int i = 0; i < flush_count; i++) {
-            block_header *cached_block = tcache.cache[sc_index].cache_list[--tcache.cache[sc_index].cache_count];
-            cached_block->next = global_list->free_list;
-            global_list->free_list = cached_block;
-        }
+    Globally *global_list = &owner->classes[sc_index];
+    if (pthread_mutex_lock(&global_list->lock) == 0) {
+        class_push(global_list, block);
         pthread_mutex_unlock(&global_list->lock);
-        tcache.cache[sc_index].cache_list[tcache.cache[sc_index].cache_count++] = block;
     }
 }
 
+static void *alloc_internal(const size_t size) {
+    if (size == 0) return NULL;
+    if (!atomic_load(&allocator_initialized)) {
+        init();
+        if (!atomic_load(&allocator_initialized)) return NULL;
+    }
+    if (!tcache_initialized) {
+        init_tcache();
+    }
+    if (tctl && atomic_load_explicit(&tctl->trim_requested, memory_order_relaxed)) {
+        tcache_gc();
+    }
+    return heap_alloc_internal(thread_arena, size, true);
+}
+
+void *my_alloc(const size_t size) {
+    void *ptr = alloc_internal(size);
+#if ALLOC_TRACE
+    if (atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {
+        trace_event(TRACE_OP_ALLOC, size, ptr);
+    }
+#endif
+    return ptr;
+}
+
+void my_free(void *ptr) {
+    if (!ptr || !atomic_load(&allocator_initialized)) return;
+#if ALLOC_TRACE
+    if (atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {
+        trace_event(TRACE_OP_FREE, 0, ptr);
+    }
+#endif
+    if (!tcache_initialized) {
+        init_tcache();
+    }
+    if (tctl && atomic_load_explicit(&tctl->trim_requested, memory_order_relaxed)) {
+        tcache_gc();
+    }
+    heap_free_internal(NULL, ptr, true);
+}
+
+heap *heap_create(void) {
+    if (!atomic_load(&allocator_initialized)) {
+        init();
+        if (!atomic_load(&allocator_initialized)) return NULL;
+    }
+    heap *h = meta_alloc(sizeof(heap));
+    if (!h) return NULL;
+    heap_setup(h);
+    heap_register(h);
+    return h;
+}
+
+void *heap_alloc(heap *h, const size_t size) {
+    if (!h || size == 0) return NULL;
+    void *ptr = heap_alloc_internal(h, size, false);
+#if ALLOC_TRACE
+    if (atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {
+        trace_event(TRACE_OP_ALLOC, size, ptr);
+    }
+#endif
+    return ptr;
+}
+
+void heap_free(heap *h, void *ptr) {
+    if (!h || !ptr) return;
+#if ALLOC_TRACE
+    if (atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {
+        trace_event(TRACE_OP_FREE, 0, ptr);
+    }
+#endif
+    heap_free_internal(h, ptr, false);
+}
+
+// Callers must not use h or any of its blocks concurrently or afterwards
+void heap_destroy(heap *h) {
+    if (!h || h->is_arena) return;
+    heap_unregister(h);
+    heap_release(h);
+    meta_free(h);
+}
+
 void print_allocator_status(void) {
     printf("=== Allocator Status ===\n");
     if (!atomic_load(&allocator_initialized)) {
@@ -335,33 +1132,264 @@ void print_allocator_status(void) {
         return;
     }
     for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
-        if (!global_mem.global_free_list[i]) continue;
         int free_count = 0;
-        block_header *blk = global_mem.global_free_list[i]->free_list;
-        while (blk && free_count < 1000) {
-            free_count++;
-            blk = blk->next;
+        for (int a = 0; a < NUM_ARENAS; a++) {
+            Globally *global_list = &arenas[a].classes[i];
+            if (pthread_mutex_lock(&global_list->lock) != 0) continue;
+            for (slab_node *slab = global_list->partial; slab; slab = slab->partial_next) {
+                free_count += slab->free_count;
+            }
+            pthread_mutex_unlock(&global_list->lock);
         }
         int tcache_count = tcache_initialized ? tcache.cache[i].cache_count : 0;
-        if (free_count > 0 || tcache_count > 0) {
-            printf("Size Class %zu: %d free blocks, %d in tcache\n",
-                   size_classes[i], free_count, tcache_count);
-        }
+        printf("Size Class %zu: %d free blocks, %d in tcache, %zuKB slabs of %d blocks, %.1f%% slab waste\n",
+               size_classes[i], free_count, tcache_count, class_slab_size[i] / 1024,
+               class_blocks_per_slab[i], 100.0 * slab_waste_ratio(i));
     }
+    allocator_stats stats;
+    allocator_get_stats(&stats);
+    printf("Slabs: %zu (%zu bytes, %.1f%% waste), large blocks: %zu (%zu bytes)\n",
+           stats.slab_count, stats.slab_bytes,
+           stats.slab_bytes ? 100.0 * stats.slab_waste_bytes / stats.slab_bytes : 0.0,
+           stats.large_count, stats.large_bytes);
+    printf("Medium regions: %zu (%zu bytes reserved, %zu bytes free)\n",
+           stats.medium_region_count, stats.medium_bytes, stats.medium_free_bytes);
+    printf("Purged: %zu bytes returned to the OS so far\n", stats.purged_bytes);
     printf("=========================\n");
 }
 
+static void heap_collect_stats(heap *h, allocator_stats *stats) {
+    for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
+        Globally *global_list = &h->classes[i];
+        if (pthread_mutex_lock(&global_list->lock) != 0) continue;
+        size_t used = class_block_size[i] * (size_t)class_blocks_per_slab[i];
+        for (slab_node *slab = global_list->slabs; slab; slab = slab->next) {
+            stats->slab_count++;
+            stats->slab_bytes += slab->size;
+            stats->slab_waste_bytes += slab->size - used;
+        }
+        pthread_mutex_unlock(&global_list->lock);
+    }
+    if (pthread_mutex_lock(&h->large_lock) == 0) {
+        for (slab_node *slab = h->large_slabs; slab; slab = slab->next) {
+            stats->large_count++;
+            stats->large_bytes += slab->size;
+        }
+        pthread_mutex_unlock(&h->large_lock);
+    }
+    medium_heap *medium = &h->medium;
+    if (pthread_mutex_lock(&medium->lock) == 0) {
+        for (medium_region *region = medium->regions; region; region = region->next) {
+            stats->medium_region_count++;
+            stats->medium_bytes += MEDIUM_REGION_SIZE;
+        }
+        for (int bin = 0; bin < MEDIUM_BINS; bin++) {
+            for (medium_span *span = medium->bins[bin]; span; span = span->next) {
+                stats->medium_free_bytes += span->header.size;
+            }
+        }
+        pthread_mutex_unlock(&medium->lock);
+    }
+    stats->purged_bytes += atomic_load_explicit(&h->purged_bytes, memory_order_relaxed);
+}
+
+void allocator_get_stats(allocator_stats *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!atomic_load(&allocator_initialized)) return;
+    for (int a = 0; a < NUM_ARENAS; a++) {
+        heap_collect_stats(&arenas[a], stats);
+    }
+}
+
+void heap_get_stats(heap *h, allocator_stats *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!h) return;
+    heap_collect_stats(h, stats);
+}
+
+// Moves slabs that were entirely free on two consecutive passes to the
+// purged list and releases their pages. Costs one step per slab, since
+// every slab tracks its own free blocks. Caller holds global_list->lock.
+static void purge_empty_slabs(heap *h, Globally *global_list, const int sc_index) {
+    const int full = class_blocks_per_slab[sc_index];
+    slab_node **slab_link = &global_list->slabs;
+    while (*slab_link) {
+        slab_node *slab = *slab_link;
+        if (slab->free_count < full) {
+            slab->decay = 0;
+        } else if (slab->decay++ > 0) {
+            *slab_link = slab->next;
+            partial_unlink(global_list, slab);
+            slab->free_list = NULL;
+            slab->free_count = 0;
+            madvise(slab->slab, slab->size, MADV_DONTNEED);
+            atomic_fetch_add_explicit(&h->purged_bytes, slab->size, memory_order_relaxed);
+            slab->next = global_list->purged;
+            global_list->purged = slab;
+            continue;
+        }
+        slab_link = &slab->next;
+    }
+}
+
+// Releases the pages of free medium spans and cached large mappings that
+// stayed unused for two passes. Their first page keeps the block header.
+// Cached large mappings still unused after MAINT_UNMAP_PASSES are unmapped.
+// Locks are only tried: a busy class or tier is simply left for the next pass.
+static void purge_heap(heap *h) {
+    for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
+        Globally *global_list = &h->classes[i];
+        if (pthread_mutex_trylock(&global_list->lock) == 0) {
+            purge_empty_slabs(h, global_list, i);
+            pthread_mutex_unlock(&global_list->lock);
+        }
+    }
+    medium_heap *medium = &h->medium;
+    if (pthread_mutex_trylock(&medium->lock) == 0) {
+        for (int bin = 0; bin < MEDIUM_BINS; bin++) {
+            for (medium_span *span = medium->bins[bin]; span; span = span->next) {
+                if (span->header.size > MEDIUM_PAGE_SIZE && span->decay++ == 1) {
+                    madvise((char *)span + MEDIUM_PAGE_SIZE,
+                            span->header.size - MEDIUM_PAGE_SIZE, MADV_DONTNEED);
+                    atomic_fetch_add_explicit(&h->purged_bytes, span->header.size - MEDIUM_PAGE_SIZE,
+                                              memory_order_relaxed);
+                }
+            }
+        }
+        pthread_mutex_unlock(&medium->lock);
+    }
+    if (pthread_mutex_trylock(&h->large_lock) == 0) {
+        slab_node **link = &h->large_slabs;
+        while (*link) {
+            slab_node *node = *link;
+            large_block *block = (large_block *)node->slab;
+            if (!block->free) {
+                node->decay = 0;
+            } else if (node->decay >= MAINT_UNMAP_PASSES - 1) {
+                *link = node->next;
+                munmap(node->slab, node->size);
+                meta_free(node);
+                continue;
+            } else if (node->size > MEDIUM_PAGE_SIZE && node->decay++ == 1) {
+                madvise((char *)node->slab + MEDIUM_PAGE_SIZE,
+                        node->size - MEDIUM_PAGE_SIZE, MADV_DONTNEED);
+                atomic_fetch_add_explicit(&h->purged_bytes, node->size - MEDIUM_PAGE_SIZE,
+                                          memory_order_relaxed);
+            }
+            link = &node->next;
+        }
+        pthread_mutex_unlock(&h->large_lock);
+    }
+}
+
+void allocator_maintenance_run(void) {
+    if (!atomic_load(&allocator_initialized)) return;
+    pthread_mutex_lock(&maint.lock);
+    tcache_ctl **link = &maint.threads;
+    while (*link) {
+        tcache_ctl *ctl = *link;
+        if (atomic_load(&ctl->retired)) {
+            *link = ctl->next;
+            meta_free(ctl);
+            continue;
+        }
+        atomic_store_explicit(&ctl->trim_requested, true, memory_order_relaxed);
+        link = &ctl->next;
+    }
+    for (heap *h = maint.heaps; h; h = h->next) {
+        purge_heap(h);
+    }
+    pthread_mutex_unlock(&maint.lock);
+    allocator_stats stats;
+    allocator_get_stats(&stats);
+    pthread_mutex_lock(&maint.stats_lock);
+    maint.published = stats;
+    pthread_mutex_unlock(&maint.stats_lock);
+    if (maint.print_stats) {
+        fprintf(stderr, "[alloc] slabs %zu (%zu bytes), medium %zu bytes (%zu free), "
+                "large %zu bytes, purged %zu bytes\n",
+                stats.slab_count, stats.slab_bytes, stats.medium_bytes,
+                stats.medium_free_bytes, stats.large_bytes, stats.purged_bytes);
+    }
+}
+
+static void *maintenance_worker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&maint.lock);
+    while (atomic_load(&maint.running)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += maint.interval_ms / 1000;
+        deadline.tv_nsec += (long)(maint.interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&maint.wake, &maint.lock, &deadline);
+        if (!atomic_load(&maint.running)) break;
+        pthread_mutex_unlock(&maint.lock);
+        allocator_maintenance_run();
+        pthread_mutex_lock(&maint.lock);
+    }
+    pthread_mutex_unlock(&maint.lock);
+    return NULL;
+}
+
+int allocator_maintenance_start(const unsigned interval_ms) {
+    if (!atomic_load(&allocator_initialized)) {
+        init();
+        if (!atomic_load(&allocator_initialized)) return -1;
+    }
+    pthread_mutex_lock(&maint.lock);
+    if (atomic_load(&maint.running)) {
+        pthread_mutex_unlock(&maint.lock);
+        return -1;
+    }
+    const char *print = getenv(MAINT_STATS_ENV);
+    maint.interval_ms = interval_ms ? interval_ms : MAINT_DEFAULT_INTERVAL_MS;
+    maint.print_stats = print && *print && *print != '0';
+    atomic_store(&maint.running, true);
+    if (pthread_create(&maint.worker, NULL, maintenance_worker, NULL) != 0) {
+        fprintf(stderr, "Error: pthread_create failed in allocator_maintenance_start\n");
+        atomic_store(&maint.running, false);
+        pthread_mutex_unlock(&maint.lock);
+        return -1;
+    }
+    pthread_mutex_unlock(&maint.lock);
+    return 0;
+}
+
+void allocator_maintenance_stop(void) {
+    pthread_mutex_lock(&maint.lock);
+    if (!atomic_load(&maint.running)) {
+        pthread_mutex_unlock(&maint.lock);
+        return;
+    }
+    atomic_store(&maint.running, false);
+    pthread_cond_signal(&maint.wake);
+    pthread_mutex_unlock(&maint.lock);
+    pthread_join(maint.worker, NULL);
+}
+
+void allocator_published_stats(allocator_stats *stats) {
+    if (!stats) return;
+    pthread_mutex_lock(&maint.stats_lock);
+    *stats = maint.published;
+    pthread_mutex_unlock(&maint.stats_lock);
+}
+
 void thread_cache_cleanup(void) {
     if (!tcache_initialized) return;
     for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
-        Globally *global_list = global_mem.global_free_list[i];
-        if (global_list && tcache.cache[i].cache_count > 0) {
+        Globally *global_list = &thread_arena->classes[i];
+        if (tcache.cache[i].cache_count > 0) {
             if (pthread_mutex_lock(&global_list->lock) == 0) {
                 for (int j = 0; j < tcache.cache[i].cache_count; j++) {
                     block_header *block = tcache.cache[i].cache_list[j];
                     if (block) {
-                        block->next = global_list->free_list;
-                        global_list->free_list = block;
+                        class_push(global_list, block);
                     }
                 }
                 tcache.cache[i].cache_count = 0;
@@ -372,39 +1400,37 @@ void thread_cache_cleanup(void) {
     tcache_initialized = false;
 }
 
+// Blocks held in the calling thread's cache, across all classes
+int thread_cache_count(void) {
+    if (!tcache_initialized) return 0;
+    int count = 0;
+    for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
+        count += tcache.cache[i].cache_count;
+    }
+    return count;
+}
+
 void allocator_cleanup(void) {
     if (!atomic_load(&allocator_initialized)) return;
+    allocator_maintenance_stop();
+    allocator_trace_stop();
     thread_cache_cleanup();
-    for (int i = 0; i < MAX_SIZE_CLASSES; i++) {
-        if (global_mem.global_free_list[i]) {
-            slab_node *slab = global_mem.global_free_list[i]->slabs;
-            while (slab) {
-                slab_node *next = slab->next;
-                if (slab->slab) {
-                    munmap(slab->slab, slab->size);
-                }
-                meta_free(slab);
-                slab = next;
-            }
-            pthread_mutex_destroy(&global_mem.global_free_list[i]->lock);
-            meta_free(global_mem.global_free_list[i]);
-        }
-    }
-    slab_node *large_slab = global_mem.large_slabs;
-    while (large_slab) {
-        slab_node *next = large_slab->next;
-        if (large_slab->slab) {
-            large_block *block = (large_block *)large_slab->slab;
-            size_t size = block->size;
-            munmap(large_slab->slab, align_size(size + sizeof(large_block)));
-        }
-        meta_free(large_slab);
-        large_slab = next;
+    for (int a = 0; a < NUM_ARENAS; a++) {
+        heap_release(&arenas[a]);
     }
-    if (meta_allocator.slab) {
-        pthread_mutex_destroy(&meta_allocator.lock);
-        munmap(meta_allocator.slab, META_SLAB_SIZE);
-        meta_allocator.slab = NULL;
+    pthread_mutex_lock(&maint.lock);
+    maint.heaps = NULL;
+    maint.threads = NULL;
+    pthread_mutex_unlock(&maint.lock);
+    tctl = NULL;
+    pthread_mutex_lock(&meta_allocator.lock);
+    while (meta_allocator.slabs) {
+        meta_slab *next = meta_allocator.slabs->next;
+        munmap(meta_allocator.slabs, meta_allocator.slabs->size);
+        meta_allocator.slabs = next;
     }
+    meta_allocator.slab = NULL;
+    memset(meta_allocator.bins, 0, sizeof(meta_allocator.bins));
+    pthread_mutex_unlock(&meta_allocator.lock);
     atomic_store(&allocator_initialized, false);
 }
@@ -15,21 +15,51 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <time.h>
 
 #define true 1
 #define false 0
 
 // Configuration constants
 #define ALIGNMENT 16
-#define SLAB_SIZE (64 * 1024) // 64KB slabs
-#define MAX_SIZE_CLASSES 23
+#define SLAB_SIZE (64 * 1024) // 64KB minimum slab
+#define MAX_SLAB_SIZE (1024 * 1024) // 1MB largest per-class slab
+#define SLAB_WASTE_TARGET 0.02 // pick the smallest slab wasting at most 2%
+#define MAX_SIZE_CLASSES 32
+#define SMALL_LOOKUP_MAX 1024 // sizes up to this use the class lookup table
 #define CACHE_SIZE 32
 #define LARGE_BLOCK_THRESHOLD 65536
-#define META_SLAB_SIZE (64 * 1024) // 64KB for metadata allocation
+#define MEDIUM_MAX_SIZE (1024 * 1024) // up to 1MB is carved from medium regions
+#define MEDIUM_REGION_SIZE (32 * 1024 * 1024) // 32MB reserved per medium region
+#define MEDIUM_PAGE_SIZE 4096
+#define MEDIUM_REGION_PAGES (MEDIUM_REGION_SIZE / MEDIUM_PAGE_SIZE)
+#define MEDIUM_MAX_PAGES ((MEDIUM_MAX_SIZE + MEDIUM_PAGE_SIZE) / MEDIUM_PAGE_SIZE)
+#define MEDIUM_BINS (MEDIUM_MAX_PAGES + 1) // one bin per page count, plus one for bigger spans
+#define META_SLAB_SIZE (64 * 1024) // 64KB per metadata slab; more are chained on demand
+#define META_BINS 32 // exact-size metadata free lists, 8 bytes apart up to 256 bytes
+#define NUM_ARENAS 4 // internal heaps that threads are spread across
+
+// Background maintenance (off unless ALLOC_DECAY_MS is set or started explicitly)
+#define MAINT_DEFAULT_INTERVAL_MS 1000
+#define MAINT_INTERVAL_ENV "ALLOC_DECAY_MS"
+#define MAINT_STATS_ENV "ALLOC_STATS_PRINT"
+#define MAINT_UNMAP_PASSES 8 // cached large mappings idle this many passes are unmapped
 
 // Magic numbers
 #define BLOCK_MAGIC 0xDEADBEEF
 #define LARGE_MAGIC 0xFEEDFACE
+#define MEDIUM_MAGIC 0xFACEB00C
+#define TRACE_MAGIC 0x43415254 // "TRAC"
+
+// Allocation tracing (build with -DALLOC_TRACE=0 to compile it out)
+#ifndef ALLOC_TRACE
+#define ALLOC_TRACE 1
+#endif
+#define TRACE_RING_RECORDS 16384 // per-thread ring capacity, power of two
+#define TRACE_FLUSH_INTERVAL_MS 10
+#define TRACE_FILE_CHUNK (16 * 1024 * 1024) // trace file grows in 16MB steps
+#define TRACE_ENV "ALLOC_TRACE_FILE"
 
 
 typedef struct meta_block {
@@ -44,30 +74,72 @@ typedef struct block_header {
     bool freed;
     uint32_t magic;
     struct block_header *next;
+    struct slab_node *slab;
 } block_header;
 
 // Slab node structure
 typedef struct slab_node {
     void *slab;
     size_t size;
+    struct heap *owner;
+    struct block_header *free_list; // this slab's free blocks held by the heap
+    int free_count; // blocks on free_list
+    int decay;      // passes seen idle; purged once it reaches 2
     struct slab_node *next;
+    struct slab_node *partial_next; // Globally::partial links, valid while free_count > 0
+    struct slab_node *partial_prev;
 } slab_node;
 
-// Large block structure
+// Large block structure; aligned so the user pointer after it stays ALIGNMENT-aligned
 typedef struct large_block {
-    size_t size;
+    _Alignas(ALIGNMENT) size_t size;
+    struct heap *owner;
     int free;
     bool freed;
     struct large_block *next;
     uint32_t magic;
 } large_block;
 
+// Span in a medium region; next/prev are only valid while the span is free
+typedef struct medium_span {
+    large_block header;
+    struct medium_span *next;
+    struct medium_span *prev;
+    int decay;
+} medium_span;
+
+// Medium region header, stored in the first pages of each aligned region.
+// page_map holds (pages << 1 | free) for the first and last page of every span.
+typedef struct medium_region {
+    struct medium_region *next;
+    struct medium_heap *owner;
+    uint32_t page_map[MEDIUM_REGION_PAGES];
+} medium_region;
+
+#define MEDIUM_HEADER_PAGES ((sizeof(medium_region) + MEDIUM_PAGE_SIZE - 1) / MEDIUM_PAGE_SIZE)
+
+// Segregated-fit span allocator for medium blocks
+typedef struct medium_heap {
+    pthread_mutex_t lock;
+    medium_region *regions;
+    medium_span *bins[MEDIUM_BINS];
+    uint64_t bin_bitmap[(MEDIUM_BINS + 63) / 64];
+} medium_heap;
+
 // Per-size-class cache for thread-local storage
 typedef struct cache_entry {
     block_header *cache_list[CACHE_SIZE];
     int cache_count;
+    int low_water; // fewest cached blocks since the last trim
 } cache_entry;
 
+// Per-thread control block the maintenance thread uses to request tcache trims
+typedef struct tcache_ctl {
+    _Atomic bool trim_requested;
+    _Atomic bool retired;
+    struct tcache_ctl *next;
+} tcache_ctl;
+
 // Thread cache structure
 typedef struct tcache_t {
     cache_entry cache[MAX_SIZE_CLASSES];
@@ -77,22 +149,89 @@ typedef struct tcache_t {
 typedef struct Globally {
     pthread_mutex_t lock;
     slab_node *slabs;
-    block_header *free_list;
+    slab_node *purged;  // empty slabs released to the OS, reused before mapping new ones
+    slab_node *partial; // slabs with free blocks; allocation takes from the head
 } Globally;
 
-// Global heap structure
+// Heap: one of the internal arenas, or an explicit heap from heap_create()
 typedef struct heap {
-    Globally *global_free_list[MAX_SIZE_CLASSES];
+    Globally classes[MAX_SIZE_CLASSES];
     large_block *large_free_list;
     slab_node *large_slabs;
+    pthread_mutex_t large_lock;
+    medium_heap medium;
+    _Atomic size_t purged_bytes; // bytes released by purge passes, for stats
+    bool is_arena;
+    struct heap *next; // maintenance registry link
 } heap;
 
+// Trace operations
+enum {
+    TRACE_OP_ALLOC = 1,
+    TRACE_OP_FREE = 2
+};
+
+// Trace record as written to the trace file (24 bytes)
+typedef struct trace_record {
+    uint64_t timestamp_ns;
+    uint64_t ptr_id;
+    uint32_t size;
+    uint16_t thread_id;
+    uint8_t op;
+    uint8_t reserved;
+} trace_record;
+
+// Trace file header, followed by record_count trace_records
+typedef struct trace_file_header {
+    uint32_t magic;
+    uint32_t record_size;
+    uint64_t record_count;
+    uint64_t dropped;
+} trace_file_header;
+
+// Per-thread single-producer ring drained by the trace flusher thread
+typedef struct trace_ring {
+    trace_record records[TRACE_RING_RECORDS];
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    _Atomic uint64_t dropped;
+    _Atomic bool retired;
+    uint16_t thread_id;
+    struct trace_ring *next;
+} trace_ring;
+
+// Allocator memory statistics
+typedef struct allocator_stats {
+    size_t slab_count;
+    size_t slab_bytes;
+    size_t slab_waste_bytes;
+    size_t medium_region_count;
+    size_t medium_bytes;
+    size_t medium_free_bytes;
+    size_t large_count;
+    size_t large_bytes;
+    size_t purged_bytes; // total bytes passed to madvise by maintenance passes
+} allocator_stats;
+
 // Function declarations
 void *my_alloc(size_t size);
 void my_free(void *ptr);
 void init(void);
 void allocator_cleanup(void);
 void thread_cache_cleanup(void);
+int thread_cache_count(void);
 void print_allocator_status(void);
+void allocator_get_stats(allocator_stats *stats);
+heap *heap_create(void);
+void *heap_alloc(heap *h, size_t size);
+void heap_free(heap *h, void *ptr);
+void heap_destroy(heap *h);
+void heap_get_stats(heap *h, allocator_stats *stats);
+int allocator_maintenance_start(unsigned interval_ms);
+void allocator_maintenance_stop(void);
+void allocator_maintenance_run(void);
+void allocator_published_stats(allocator_stats *stats);
+int allocator_trace_start(const char *path);
+void allocator_trace_stop(void);
 
 #endif // ALLOC_H
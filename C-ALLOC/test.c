@@ -7,11 +7,13 @@
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <unistd.h>
 
 #define NUM_ALLOCS 10000
 #define NUM_THREADS 5
 
 size_t sizes[] = {32, 64, 128, 512, 1024, 2048};
+int failures = 0;
 #define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
 
 double now_sec() {
@@ -200,7 +202,7 @@ void stress_test() {
 void benchmark_large_allocs() {
     printf("\n=== Large Allocation Benchmark ===\n");
 
-    size_t large_sizes[] = {65536, 131072, 262144, 524288, 1048576};
+    size_t large_sizes[] = {65536, 131072, 262144, 524288, 1048576, 4194304};
     int num_large_sizes = sizeof(large_sizes) / sizeof(large_sizes[0]);
 
     double start = now_sec();
@@ -230,9 +232,301 @@ void benchmark_large_allocs() {
     }
     end = now_sec();
     printf("[Standard malloc Large] Time: %.6f seconds\n", end - start);
+
+    // Per-size breakdown: several live buffers at once, as in a request pipeline
+    void *live[8];
+    for (int s = 0; s < num_large_sizes; s++) {
+        size_t size = large_sizes[s];
+        start = now_sec();
+        for (int i = 0; i < 100; i++) {
+            for (int j = 0; j < 8; j++) {
+                live[j] = my_alloc(size);
+                if (live[j]) ((char *)live[j])[size - 1] = 1;
+            }
+            for (int j = 0; j < 8; j++) my_free(live[j]);
+        }
+        double custom = now_sec() - start;
+        start = now_sec();
+        for (int i = 0; i < 100; i++) {
+            for (int j = 0; j < 8; j++) {
+                live[j] = malloc(size);
+                if (live[j]) ((volatile char *)live[j])[size - 1] = 1;
+            }
+            for (int j = 0; j < 8; j++) free(live[j]);
+        }
+        double standard = now_sec() - start;
+        printf("[Large %7zu bytes] Custom: %.6f seconds, Standard malloc: %.6f seconds\n",
+               size, custom, standard);
+    }
+}
+
+// Weighted request mix: mostly small objects, a tail of buffers up to 48KB
+typedef struct size_mix {
+    size_t min;
+    size_t max;
+    int weight;
+} size_mix;
+
+size_mix realistic_mix[] = {
+    {8, 64, 30}, {65, 256, 30}, {257, 1024, 22},
+    {1025, 4096, 12}, {4097, 16384, 4}, {16385, 49152, 2}
+};
+#define NUM_MIX (sizeof(realistic_mix) / sizeof(realistic_mix[0]))
+#define MIX_OBJECTS 20000
+
+size_t pick_mixed_size() {
+    int total = 0;
+    for (size_t i = 0; i < NUM_MIX; i++) total += realistic_mix[i].weight;
+    int r = rand() % total;
+    for (size_t i = 0; i < NUM_MIX; i++) {
+        if (r < realistic_mix[i].weight) {
+            return realistic_mix[i].min + rand() % (realistic_mix[i].max - realistic_mix[i].min + 1);
+        }
+        r -= realistic_mix[i].weight;
+    }
+    return realistic_mix[0].min;
+}
+
+void benchmark_memory_efficiency() {
+    printf("\n=== Memory Efficiency (realistic size mix) ===\n");
+
+    static void *ptrs[MIX_OBJECTS];
+    size_t requested = 0;
+    allocator_stats before, after;
+    srand(42);
+    allocator_get_stats(&before);
+    for (int i = 0; i < MIX_OBJECTS; i++) {
+        size_t size = pick_mixed_size();
+        ptrs[i] = my_alloc(size);
+        if (ptrs[i]) {
+            memset(ptrs[i], 0xAB, size);
+            requested += size;
+        }
+    }
+    allocator_get_stats(&after);
+    size_t reserved = after.slab_bytes - before.slab_bytes;
+    size_t waste = after.slab_waste_bytes - before.slab_waste_bytes;
+    printf("[Custom Allocator Efficiency] Requested: %zu bytes, Slabs: %zu bytes (%zu slabs)\n",
+           requested, reserved, after.slab_count - before.slab_count);
+    printf("[Custom Allocator Efficiency] Efficiency: %.1f%%, Slab tail waste: %.2f%%\n",
+           reserved ? 100.0 * requested / reserved : 0.0,
+           reserved ? 100.0 * waste / reserved : 0.0);
+    for (int i = 0; i < MIX_OBJECTS; i++) {
+        my_free(ptrs[i]);
+    }
+    thread_cache_cleanup();
+}
+
+#define NUM_CONNECTIONS 100
+#define CONNECTION_OBJECTS 1000
+#define LIVE_HEAPS 1000
+#define LIVE_HEAP_BATCH 100 // creations timed at the start and end of the live-heap run
+
+void benchmark_heaps() {
+    printf("\n=== Per-Connection Heap Benchmark ===\n");
+
+    static void *objs[CONNECTION_OBJECTS];
+    double heap_teardown = 0, free_teardown = 0;
+    for (int c = 0; c < NUM_CONNECTIONS; c++) {
+        heap *h = heap_create();
+        if (!h) {
+            fprintf(stderr, "[Custom Allocator Heaps] heap_create failed at connection %d\n", c);
+            return;
+        }
+        for (int i = 0; i < CONNECTION_OBJECTS; i++) {
+            size_t size = sizes[i % NUM_SIZES];
+            void *ptr = heap_alloc(h, size);
+            if (ptr) memset(ptr, 0xCD, size);
+        }
+        double start = now_sec();
+        heap_destroy(h);
+        heap_teardown += now_sec() - start;
+
+        h = heap_create();
+        if (!h) {
+            fprintf(stderr, "[Custom Allocator Heaps] heap_create failed at connection %d\n", c);
+            return;
+        }
+        for (int i = 0; i < CONNECTION_OBJECTS; i++) {
+            size_t size = sizes[i % NUM_SIZES];
+            objs[i] = heap_alloc(h, size);
+            if (objs[i]) memset(objs[i], 0xCD, size);
+        }
+        start = now_sec();
+        for (int i = 0; i < CONNECTION_OBJECTS; i++) {
+            heap_free(h, objs[i]);
+        }
+        heap_destroy(h);
+        free_teardown += now_sec() - start;
+    }
+    printf("[Custom Allocator Heaps] heap_destroy teardown: %.6f seconds\n", heap_teardown);
+    printf("[Custom Allocator Heaps] Per-object heap_free teardown: %.6f seconds\n", free_teardown);
+
+    // Creating a heap should cost the same with many heaps already live
+    static heap *live[LIVE_HEAPS];
+    int created = 0;
+    double first_batch = 0, last_batch = 0;
+    while (created < LIVE_HEAPS) {
+        double start = now_sec();
+        if (!(live[created] = heap_create())) break;
+        heap_alloc(live[created], 64);
+        double elapsed = now_sec() - start;
+        if (created < LIVE_HEAP_BATCH) first_batch += elapsed;
+        if (created >= LIVE_HEAPS - LIVE_HEAP_BATCH) last_batch += elapsed;
+        created++;
+    }
+    printf("[Custom Allocator Heaps] Live heaps created: %d of %d\n", created, LIVE_HEAPS);
+    printf("[Custom Allocator Heaps] First %d creates: %.6f seconds, last %d: %.6f seconds\n",
+           LIVE_HEAP_BATCH, first_batch, LIVE_HEAP_BATCH, last_batch);
+    if (created < LIVE_HEAPS) {
+        fprintf(stderr, "[Custom Allocator Heaps] FAILED: heap_create ran out of metadata\n");
+        failures++;
+    } else if (last_batch > 4 * first_batch + 0.002) {
+        fprintf(stderr, "[Custom Allocator Heaps] FAILED: heap_create slows down as heaps accumulate\n");
+        failures++;
+    }
+    while (created > 0) {
+        heap_destroy(live[--created]);
+    }
+
+    heap *a = heap_create();
+    heap *b = heap_create();
+    void *ptr = heap_alloc(a, 128);
+    void *big = heap_alloc(a, 4 * 1024 * 1024);
+    heap_free(b, ptr);
+    heap_free(b, big);
+    allocator_stats stats;
+    heap_get_stats(b, &stats);
+    bool ignored = ptr && !((block_header *)ptr - 1)->freed &&
+                   big && !((large_block *)big - 1)->freed;
+    printf("[Custom Allocator Heaps] Foreign heap_free ignored: %s, slabs in other heap: %zu\n",
+           ignored ? "yes" : "no", stats.slab_count);
+    if (!ignored) {
+        fprintf(stderr, "[Custom Allocator Heaps] FAILED: foreign heap_free released a block\n");
+        failures++;
+    }
+    heap_free(a, big);
+    heap_free(a, ptr);
+    heap_destroy(a);
+    heap_destroy(b);
+}
+
+size_t resident_bytes() {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(f);
+    }
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
 }
+
+void decay_test() {
+    printf("\n=== Background Decay Test ===\n");
+
+    static void *ptrs[MIX_OBJECTS];
+    void *buffers[16];
+    srand(7);
+    for (int i = 0; i < MIX_OBJECTS; i++) {
+        size_t size = pick_mixed_size();
+        ptrs[i] = my_alloc(size);
+        if (ptrs[i]) memset(ptrs[i], 0xA5, size);
+    }
+    for (int i = 0; i < 16; i++) {
+        buffers[i] = my_alloc(512 * 1024);
+        if (buffers[i]) memset(buffers[i], 0xA5, 512 * 1024);
+    }
+    size_t rss_peak = resident_bytes();
+
+    for (int i = 0; i < MIX_OBJECTS; i++) my_free(ptrs[i]);
+    for (int i = 0; i < 16; i++) my_free(buffers[i]);
+    size_t rss_idle = resident_bytes();
+    int cached_idle = thread_cache_count();
+
+    // Trims run on the owning thread, so keep touching the allocator lightly;
+    // the cache is never flushed explicitly here.
+    allocator_maintenance_start(10);
+    struct timespec tick = {0, 10 * 1000000L};
+    for (int i = 0; i < 10; i++) {
+        nanosleep(&tick, NULL);
+        my_free(my_alloc(64));
+    }
+    int cached_decayed = thread_cache_count();
+    size_t rss_decayed = resident_bytes();
+    allocator_stats stats;
+    allocator_published_stats(&stats);
+    size_t purged = stats.purged_bytes;
+    for (int i = 0; i < 4 * MAINT_UNMAP_PASSES && stats.large_count > 0; i++) {
+        nanosleep(&tick, NULL);
+        allocator_published_stats(&stats);
+    }
+    allocator_maintenance_stop();
+
+    printf("[Custom Allocator Decay] RSS under load: %.1f MB, after free: %.1f MB, after decay: %.1f MB\n",
+           rss_peak / 1048576.0, rss_idle / 1048576.0, rss_decayed / 1048576.0);
+    printf("[Custom Allocator Decay] Published purged bytes: %zu, RSS fell after load stopped: %s\n",
+           purged, rss_decayed < rss_idle ? "yes" : "no");
+    printf("[Custom Allocator Decay] Thread cache: %d blocks after free, %d after idle passes\n",
+           cached_idle, cached_decayed);
+    if (cached_decayed >= cached_idle) {
+        fprintf(stderr, "[Custom Allocator Decay] FAILED: thread cache was not trimmed\n");
+        failures++;
+    }
+    if (rss_decayed >= rss_idle) {
+        fprintf(stderr, "[Custom Allocator Decay] FAILED: resident memory did not fall\n");
+        failures++;
+    }
+    printf("[Custom Allocator Decay] Cached large mappings left after idle passes: %zu\n",
+           stats.large_count);
+    if (stats.large_count > 0) {
+        fprintf(stderr, "[Custom Allocator Decay] FAILED: idle large mappings were not unmapped\n");
+        failures++;
+    }
+}
+
+void benchmark_trace() {
+    printf("\n=== Allocation Trace Benchmark ===\n");
+
+    const char *path = "alloc_trace_test.bin";
+    if (allocator_trace_start(path) != 0) {
+        printf("[Custom Allocator Traced] Tracing unavailable\n");
+        return;
+    }
+    double start = now_sec();
+    for (int i = 0; i < NUM_ALLOCS; i++) {
+        size_t size = sizes[i % NUM_SIZES];
+        void *ptr = my_alloc(size);
+        if (ptr) {
+            memset(ptr, 0xEE, size);
+            my_free(ptr);
+        }
+    }
+    double end = now_sec();
+    allocator_trace_stop();
+    printf("[Custom Allocator Traced] Time: %.6f seconds\n", end - start);
+
+    FILE *f = fopen(path, "rb");
+    trace_file_header hdr = {0};
+    if (!f || fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != TRACE_MAGIC) {
+        fprintf(stderr, "[Custom Allocator Traced] FAILED: trace file unreadable\n");
+        failures++;
+    } else {
+        printf("[Custom Allocator Traced] Records: %llu written, %llu dropped\n",
+               (unsigned long long)hdr.record_count, (unsigned long long)hdr.dropped);
+        if (hdr.dropped != 0 || hdr.record_count != 2 * NUM_ALLOCS) {
+            fprintf(stderr, "[Custom Allocator Traced] FAILED: expected %d records and no drops\n",
+                    2 * NUM_ALLOCS);
+            failures++;
+        }
+    }
+    if (f) fclose(f);
+    remove(path);
+}
+
 int main() {
-    printf("=== Performance Comparison ===\n");
+    benchmark_memory_efficiency();
+
+    printf("\n=== Performance Comparison ===\n");
     benchmark_malloc();
     benchmark_custom();
     printf("\n=== Multi-threaded Benchmarks ===\n");
@@ -242,10 +536,17 @@ int main() {
     stress_test();
     thread_cache_cleanup();
     benchmark_large_allocs();
+    benchmark_heaps();
+    benchmark_trace();
+    decay_test();
 
     printf("\n=== Final Allocator Status ===\n");
     print_allocator_status();
 
     allocator_cleanup();
+    if (failures) {
+        fprintf(stderr, "%d check(s) FAILED\n", failures);
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,226 @@
+/* PRIYANSHU MORBAITA */
+
+/*
+ * Offline summary for allocation traces written with ALLOC_TRACE_FILE.
+ * Prints the request size histogram and suggests a size_classes[] table
+ * that minimises internal fragmentation for the recorded workload.
+ *
+ * Usage: ./trace_summary <trace file>
+ */
+
+#include "alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <sys/stat.h>
+
+#define NUM_BUCKETS (LARGE_BLOCK_THRESHOLD / ALIGNMENT)
+#define HIST_BAR_WIDTH 50
+
+static const char *op_name(const uint8_t op) {
+    return op == TRACE_OP_ALLOC ? "alloc" : op == TRACE_OP_FREE ? "free" : "unknown";
+}
+
+static void print_histogram(const uint64_t *pow2_counts, const int max_bits, const uint64_t total) {
+    uint64_t peak = 0;
+    for (int b = 0; b <= max_bits; b++) {
+        if (pow2_counts[b] > peak) peak = pow2_counts[b];
+    }
+    printf("\n=== Request Size Histogram ===\n");
+    for (int b = 0; b <= max_bits; b++) {
+        if (!pow2_counts[b]) continue;
+        size_t lo = b == 0 ? 1 : ((size_t)1 << (b - 1)) + 1;
+        size_t hi = (size_t)1 << b;
+        int bar = (int)(pow2_counts[b] * HIST_BAR_WIDTH / peak);
+        printf("%10zu - %-10zu %10llu (%5.1f%%) ", lo, hi,
+               (unsigned long long)pow2_counts[b], 100.0 * pow2_counts[b] / total);
+        for (int i = 0; i < bar; i++) putchar('#');
+        putchar('\n');
+    }
+}
+
+/*
+ * Chooses MAX_SIZE_CLASSES class sizes minimising total rounded-up bytes.
+ * Classes only need to sit at observed (aligned) sizes; the largest class
+ * is pinned at LARGE_BLOCK_THRESHOLD so every small request still fits.
+ */
+static void suggest_size_classes(const uint64_t *bucket_counts) {
+    int n = 0;
+    size_t *sizes = malloc((NUM_BUCKETS + 1) * sizeof(size_t));
+    uint64_t *counts = malloc((NUM_BUCKETS + 1) * sizeof(uint64_t));
+    if (!sizes || !counts) {
+        fprintf(stderr, "Error: out of memory in suggest_size_classes\n");
+        free(sizes);
+        free(counts);
+        return;
+    }
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        if (bucket_counts[i]) {
+            sizes[n] = (size_t)(i + 1) * ALIGNMENT;
+            counts[n] = bucket_counts[i];
+            n++;
+        }
+    }
+    if (n == 0 || sizes[n - 1] != LARGE_BLOCK_THRESHOLD) {
+        sizes[n] = LARGE_BLOCK_THRESHOLD;
+        counts[n] = 0;
+        n++;
+    }
+    if (n == 1) {
+        printf("\nNo small allocations recorded; nothing to suggest.\n");
+        free(sizes);
+        free(counts);
+        return;
+    }
+
+    // Prefix sums let cost(i..j) = sizes[j] * count(i..j) - bytes(i..j) run in O(1)
+    double *pc = calloc((size_t)n + 1, sizeof(double));
+    double *pb = calloc((size_t)n + 1, sizeof(double));
+    int k_max = n < MAX_SIZE_CLASSES ? n : MAX_SIZE_CLASSES;
+    double *best = malloc((size_t)(k_max + 1) * n * sizeof(double));
+    int *from = malloc((size_t)(k_max + 1) * n * sizeof(int));
+    if (!pc || !pb || !best || !from) {
+        fprintf(stderr, "Error: out of memory in suggest_size_classes\n");
+        goto out;
+    }
+    for (int i = 0; i < n; i++) {
+        pc[i + 1] = pc[i] + (double)counts[i];
+        pb[i + 1] = pb[i] + (double)counts[i] * (double)sizes[i];
+    }
+#define COST(i, j) ((double)sizes[j] * (pc[(j) + 1] - pc[i]) - (pb[(j) + 1] - pb[i]))
+#define BEST(k, j) best[(size_t)(k) * n + (j)]
+#define FROM(k, j) from[(size_t)(k) * n + (j)]
+    for (int j = 0; j < n; j++) {
+        BEST(1, j) = COST(0, j);
+        FROM(1, j) = -1;
+    }
+    for (int k = 2; k <= k_max; k++) {
+        for (int j = 0; j < n; j++) {
+            BEST(k, j) = DBL_MAX;
+            FROM(k, j) = -1;
+            for (int i = k - 2; i < j; i++) {
+                double cost = BEST(k - 1, i) + COST(i + 1, j);
+                if (cost < BEST(k, j)) {
+                    BEST(k, j) = cost;
+                    FROM(k, j) = i;
+                }
+            }
+        }
+    }
+
+    size_t classes[MAX_SIZE_CLASSES];
+    int k = k_max;
+    for (int j = n - 1; k >= 1; k--) {
+        classes[k - 1] = sizes[j];
+        j = FROM(k, j);
+    }
+    double requested = pb[n];
+    double waste = BEST(k_max, n - 1);
+    printf("\n=== Suggested Size Classes ===\n");
+    printf("Internal fragmentation: %.0f of %.0f bytes (%.2f%%)\n",
+           waste, requested + waste, 100.0 * waste / (requested + waste));
+    printf("static const size_t size_classes[MAX_SIZE_CLASSES] = {");
+    for (int i = 0; i < k_max; i++) {
+        printf("%s%s%zu", i ? ", " : "", i % 12 ? "" : "\n    ", classes[i]);
+    }
+    printf("\n};\n");
+    if (k_max < MAX_SIZE_CLASSES) {
+        printf("(only %d distinct sizes recorded; pad the remaining %d classes as needed)\n",
+               k_max, MAX_SIZE_CLASSES - k_max);
+    }
+#undef COST
+#undef BEST
+#undef FROM
+out:
+    free(pc);
+    free(pb);
+    free(best);
+    free(from);
+    free(sizes);
+    free(counts);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(trace_file_header)) {
+        fprintf(stderr, "Error: %s is not a trace file\n", argv[1]);
+        close(fd);
+        return 1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap failed: %s\n", strerror(errno));
+        return 1;
+    }
+    const trace_file_header *hdr = map;
+    if (hdr->magic != TRACE_MAGIC || hdr->record_size != sizeof(trace_record)) {
+        fprintf(stderr, "Error: %s has an unknown trace format\n", argv[1]);
+        munmap(map, (size_t)st.st_size);
+        return 1;
+    }
+    uint64_t available = ((size_t)st.st_size - sizeof(trace_file_header)) / sizeof(trace_record);
+    uint64_t count = hdr->record_count < available ? hdr->record_count : available;
+    const trace_record *records = (const trace_record *)(hdr + 1);
+
+    uint64_t *bucket_counts = calloc(NUM_BUCKETS, sizeof(uint64_t));
+    uint64_t pow2_counts[33] = {0};
+    uint64_t ops[3] = {0};
+    uint64_t small = 0, large = 0, bytes = 0;
+    uint64_t first_ts = UINT64_MAX, last_ts = 0;
+    int max_bits = 0;
+    uint16_t max_thread = 0;
+    if (!bucket_counts) {
+        fprintf(stderr, "Error: out of memory\n");
+        munmap(map, (size_t)st.st_size);
+        return 1;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        const trace_record *rec = &records[i];
+        if (rec->op == TRACE_OP_ALLOC || rec->op == TRACE_OP_FREE) ops[rec->op]++;
+        if (rec->timestamp_ns < first_ts) first_ts = rec->timestamp_ns;
+        if (rec->timestamp_ns > last_ts) last_ts = rec->timestamp_ns;
+        if (rec->thread_id > max_thread) max_thread = rec->thread_id;
+        if (rec->op != TRACE_OP_ALLOC || rec->size == 0) continue;
+        int bits = 0;
+        while (((uint64_t)1 << bits) < rec->size) bits++;
+        pow2_counts[bits]++;
+        if (bits > max_bits) max_bits = bits;
+        bytes += rec->size;
+        if (rec->size < LARGE_BLOCK_THRESHOLD) {
+            bucket_counts[(rec->size + ALIGNMENT - 1) / ALIGNMENT - 1]++;
+            small++;
+        } else {
+            large++;
+        }
+    }
+
+    printf("=== Trace Summary: %s ===\n", argv[1]);
+    printf("Records: %llu (%llu dropped), threads: %u, span: %.3f seconds\n",
+           (unsigned long long)count, (unsigned long long)hdr->dropped,
+           count ? (unsigned)max_thread + 1 : 0U,
+           count ? (last_ts - first_ts) / 1e9 : 0.0);
+    printf("Operations: %llu %s, %llu %s\n",
+           (unsigned long long)ops[TRACE_OP_ALLOC], op_name(TRACE_OP_ALLOC),
+           (unsigned long long)ops[TRACE_OP_FREE], op_name(TRACE_OP_FREE));
+    printf("Allocations: %llu small, %llu large, %llu bytes requested\n",
+           (unsigned long long)small, (unsigned long long)large, (unsigned long long)bytes);
+    if (small + large > 0) {
+        print_histogram(pow2_counts, max_bits, small + large);
+    }
+    suggest_size_classes(bucket_counts);
+
+    free(bucket_counts);
+    munmap(map, (size_t)st.st_size);
+    return 0;
+}